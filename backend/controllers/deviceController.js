@@ -693,6 +693,50 @@ const getDeviceById = async (req, res) => {
   }
 };
 
+// Ask the device to run its on-board benchmark (GPIO, NVS, JSON, HMAC, heap, WS RTT)
+// and wait for the diagnostics_report. Relay state is not touched by the firmware.
+const runDeviceDiagnostics = async (req, res) => {
+  try {
+    const device = await Device.findById(req.params.deviceId);
+    if (!device) {
+      return res.status(404).json({ message: 'Device not found' });
+    }
+    const ws = global.wsDevices && device.macAddress ? global.wsDevices.get(device.macAddress.toUpperCase()) : null;
+    if (!ws || ws.readyState !== 1 || !global.pendingDiagnostics) {
+      return res.status(409).json({
+        success: false,
+        code: 'device_not_identified',
+        message: 'Device is not identified/connected. Please wait for the device to connect and try again.'
+      });
+    }
+    const id = crypto.randomBytes(8).toString('hex');
+    const timeoutMs = 20000;
+    const report = await new Promise((resolve) => {
+      const timer = setTimeout(() => {
+        global.pendingDiagnostics.delete(id);
+        resolve(null);
+      }, timeoutMs);
+      global.pendingDiagnostics.set(id, {
+        mac: device.macAddress.toUpperCase(),
+        resolve: (data) => {
+          clearTimeout(timer);
+          resolve(data);
+        }
+      });
+      ws.send(JSON.stringify({ type: 'run_diagnostics', mac: device.macAddress, id }));
+    });
+    if (!report) {
+      return res.status(504).json({ success: false, code: 'diagnostics_timeout', message: 'Device did not return a diagnostics report in time' });
+    }
+    if (report.error) {
+      return res.status(409).json({ success: false, code: `diagnostics_${report.error}`, message: 'Device could not run diagnostics', data: report });
+    }
+    res.json({ success: true, data: report });
+  } catch (error) {
+    res.status(500).json({ message: 'Server error', error: error.message });
+  }
+};
+
 const deleteDevice = async (req, res) => {
   try {
     const device = await Device.findById(req.params.deviceId);
@@ -966,6 +1010,7 @@ module.exports = {
   getDeviceById,
   updateDevice,
   deleteDevice,
+  runDeviceDiagnostics,
   bulkToggleSwitches
   , bulkToggleByType
   , bulkToggleByLocation
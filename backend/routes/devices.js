@@ -11,7 +11,8 @@ const {
   getDeviceStats,
   updateDevice,
   deleteDevice,
-  getDeviceById
+  getDeviceById,
+  runDeviceDiagnostics
 } = require('../controllers/deviceController');
 const { body, param } = require('express-validator');
 
@@ -53,6 +54,9 @@ router.get('/:deviceId', checkDeviceAccess, getDeviceById);
 router.put('/:deviceId', authorize('admin', 'faculty'), checkDeviceAccess, validateDevice, updateDevice);
 router.delete('/:deviceId', authorize('admin'), checkDeviceAccess, deleteDevice);
 
+// On-device diagnostic benchmark (does not change relay state)
+router.post('/:deviceId/diagnostics', authorize('admin'), checkDeviceAccess, runDeviceDiagnostics);
+
 // Switch operations
 router.post('/:deviceId/switches/:switchId/toggle', authorize('admin', 'faculty'), checkDeviceAccess, toggleSwitch);
 
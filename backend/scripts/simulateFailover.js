@@ -0,0 +1,124 @@
+// Usage: node scripts/simulateFailover.js <MAC> <SECRET> <ws://nodeA:3001/esp32-ws> [ws://nodeB:3001/esp32-ws]
+// Speaks the ESP32 /esp32-ws protocol with the firmware's timings (ping 5 s, pong
+// timeout 12 s, reconnect 5 s). With two URLs it keeps a standby link on the second
+// node and promotes it on failover, like improved_esp32.cpp. Restart/kill the node
+// behind the active link and read the "[FAILOVER] control gap" lines.
+// Gap = last pong on the lost link -> backend acks the new one ('promoted'/'identified').
+
+const WebSocket = require('ws');
+
+const PING_MS = 5000;
+const PONG_TIMEOUT_MS = 12000;
+const RECONNECT_MS = 5000;
+const LOOP_MS = 10;
+
+const [mac, secret, ...urls] = process.argv.slice(2).filter(a => !a.startsWith('--'));
+const durationArg = process.argv.find(a => a.startsWith('--duration='));
+if (!mac || !secret || !urls.length) {
+  console.error('Usage: node scripts/simulateFailover.js <MAC> <SECRET> <ws-url> [standby-ws-url] [--duration=ms]');
+  process.exit(1);
+}
+
+const links = urls.slice(0, 2).map(url => ({ url, ws: null, connected: false, authed: false, pongSeen: false, lastPingMs: 0, lastPongMs: 0 }));
+let active = 0;
+let failoverStartMs = 0;
+let lossDetectedMs = 0;
+const gaps = [];
+const log = (msg) => console.log(`${new Date().toISOString()} ${msg}`);
+const send = (i, obj) => { const l = links[i]; if (l.connected) l.ws.send(JSON.stringify(obj)); };
+
+function identify(i, standby) {
+  send(i, { type: 'identify', mac, secret, offline_capable: true, ...(standby ? { standby: true } : {}) });
+}
+
+function markControlRestored(how) {
+  if (!failoverStartMs) return;
+  const now = Date.now();
+  const gap = now - failoverStartMs;
+  const afterDetect = now - lossDetectedMs;
+  failoverStartMs = 0;
+  gaps.push({ gap, afterDetect, how });
+  log(`[FAILOVER] control gap ${gap} ms (${how}, ${afterDetect} ms after loss was detected)`);
+}
+
+function promote(i) {
+  active = i;
+  send(i, { type: 'promote', mac });
+  send(i, { type: 'state_update', seq: Date.now(), ts: Date.now(), switches: [] });
+  log(`standby link ${i} promoted (${links[i].url})`);
+}
+
+function connect(i) {
+  const l = links[i];
+  if (l.ws) return;
+  const ws = new WebSocket(l.url);
+  l.ws = ws;
+  ws.on('open', () => {
+    Object.assign(l, { connected: true, authed: false, pongSeen: false, lastPingMs: 0, lastPongMs: Date.now() });
+    if (i !== active && !links[active].connected) active = i;
+    identify(i, i !== active);
+  });
+  ws.on('message', (msg) => {
+    let data;
+    try { data = JSON.parse(msg.toString()); } catch { return; }
+    if (data.type === 'pong') { l.lastPongMs = Date.now(); l.pongSeen = true; return; }
+    if (i !== active) {
+      if (data.type === 'identified' && data.standby) {
+        l.authed = true;
+        log(`standby link ${i} ready`);
+        if (!links[active].connected) promote(i);
+      }
+      return;
+    }
+    if (data.type === 'promoted') markControlRestored('standby promoted');
+    else if (data.type === 'identified') {
+      log(`link ${i} identified`);
+      markControlRestored('re-identified');
+      // Standby starts once the active link is up, as in the firmware
+      if (links[1 - i] && !links[1 - i].ws) connect(1 - i);
+    }
+  });
+  const onDown = () => {
+    if (l.ws !== ws) return;
+    l.ws = null;
+    const wasUp = l.connected;
+    l.connected = false;
+    l.authed = false;
+    if (wasUp && i === active) {
+      if (!failoverStartMs) {
+        failoverStartMs = l.pongSeen ? l.lastPongMs : Date.now();
+        lossDetectedMs = Date.now();
+      }
+      log(`active link ${i} lost`);
+      const other = 1 - i;
+      if (links[other] && links[other].connected && links[other].authed) promote(other);
+    }
+    setTimeout(() => connect(i), RECONNECT_MS);
+  };
+  ws.on('close', onDown);
+  ws.on('error', () => { try { ws.terminate(); } catch { } onDown(); });
+}
+
+setInterval(() => {
+  const now = Date.now();
+  links.forEach((l, i) => {
+    if (!l.connected) return;
+    if (l.pongSeen && now - l.lastPongMs > PONG_TIMEOUT_MS) {
+      log(`link ${i} pong timeout, dropping`);
+      l.ws.terminate();
+      return;
+    }
+    if (now - l.lastPingMs >= PING_MS) { l.lastPingMs = now; send(i, { type: 'ping', t: now }); }
+  });
+  const s = 1 - active;
+  if (links[s] && !links[active].connected && links[s].connected && links[s].authed) promote(s);
+}, LOOP_MS);
+
+connect(0);
+
+if (durationArg) {
+  setTimeout(() => {
+    console.log(JSON.stringify({ gaps }));
+    process.exit(0);
+  }, Number(durationArg.split('=')[1]));
+}
@@ -511,9 +511,69 @@ function emitDeviceStateChanged(device, meta = {}) {
 // Raw WebSocket server for ESP32 devices (simpler than Socket.IO on microcontroller)
 const wsDevices = new Map(); // mac -> ws
 global.wsDevices = wsDevices;
+// run_diagnostics requests awaiting a diagnostics_report (id -> { mac, resolve }), see deviceController
+const pendingDiagnostics = new Map();
+global.pendingDiagnostics = pendingDiagnostics;
 const wss = new WebSocketServer({ server, path: '/esp32-ws' });
 logger.info('Raw WebSocket /esp32-ws endpoint ready');
 
+// Make ws the device's control link: mark online, flush queued intents and push config.
+// Shared by a fresh identify and by promotion of a pre-authenticated standby link.
+async function activateEsp32Link(ws, device) {
+  const mac = ws.mac;
+  ws.standby = false;
+  wsDevices.set(mac, ws);
+  // Explicit $set: if the loaded doc already says 'online' (a stale close handler
+  // wrote 'offline' after it was read), save() would consider status unmodified
+  const Device = require('./models/Device');
+  const lastSeen = new Date();
+  await Device.updateOne({ _id: device._id }, { $set: { status: 'online', lastSeen } });
+  device.status = 'online';
+  device.lastSeen = lastSeen;
+  ws.lastSeenAt = lastSeen;
+  if (process.env.NODE_ENV !== 'production') {
+    logger.info('[identify] device marked online', { mac, lastSeen: device.lastSeen.toISOString() });
+  }
+  // Flush any queued intents
+  if (Array.isArray(device.queuedIntents) && device.queuedIntents.length) {
+    for (const intent of device.queuedIntents) {
+      try {
+        const payload = { type: 'switch_command', mac, gpio: intent.switchGpio, state: intent.desiredState };
+        ws.send(JSON.stringify(payload));
+      } catch (e) { /* ignore individual failures */ }
+    }
+    device.queuedIntents = [];
+    await device.save();
+  }
+}
+
+// Full config_update so firmware can apply current states and GPIO mapping
+function sendEsp32ConfigUpdate(ws, device) {
+  try {
+    const cfgMsg = {
+      type: 'config_update',
+      mac: ws.mac,
+      switches: device.switches.map((sw, idx) => ({
+        order: idx,
+        gpio: sw.gpio,
+        relayGpio: sw.relayGpio,
+        name: sw.name,
+        manualSwitchGpio: sw.manualSwitchGpio,
+        manualSwitchEnabled: sw.manualSwitchEnabled,
+        manualMode: sw.manualMode,
+        manualActiveLow: sw.manualActiveLow,
+        state: sw.state
+      })),
+      pirEnabled: device.pirEnabled,
+      pirGpio: device.pirGpio,
+      pirAutoOffDelay: device.pirAutoOffDelay
+    };
+    ws.send(JSON.stringify(cfgMsg));
+  } catch (e) {
+    logger.warn('[identify] failed to send config_update', e.message);
+  }
+}
+
 wss.on('connection', (ws) => {
   ws.isAlive = true;
   ws.on('pong', () => { ws.isAlive = true; });
@@ -521,9 +581,15 @@ wss.on('connection', (ws) => {
     let data;
     try { data = JSON.parse(msg.toString()); } catch { return; }
     const type = data.type;
+    if (type === 'ping') {
+      // RTT probe from firmware (used to pick the nearest backend); echo its timestamp
+      ws.send(JSON.stringify({ type: 'pong', t: data.t, id: data.id, ts: Date.now() }));
+      return;
+    }
     if (type === 'identify' || type === 'authenticate') {
       const mac = (data.mac || data.macAddress || '').toUpperCase();
       const secret = data.secret || data.signature;
+      const standby = data.standby === true;
       if (!mac) {
         ws.send(JSON.stringify({ type: 'error', reason: 'missing_mac' }));
         return;
@@ -553,24 +619,17 @@ wss.on('connection', (ws) => {
         ws.mac = mac;
         // Attach secret for this connection (if available)
         ws.secret = (device && device.deviceSecret) ? device.deviceSecret : undefined;
-        wsDevices.set(mac, ws);
-        device.status = 'online';
-        device.lastSeen = new Date();
-        await device.save();
-        if (process.env.NODE_ENV !== 'production') {
-          logger.info('[identify] device marked online', { mac, lastSeen: device.lastSeen.toISOString() });
-        }
-        // Flush any queued intents
-        if (Array.isArray(device.queuedIntents) && device.queuedIntents.length) {
-          for (const intent of device.queuedIntents) {
-            try {
-              const payload = { type: 'switch_command', mac, gpio: intent.switchGpio, state: intent.desiredState };
-              ws.send(JSON.stringify(payload));
-            } catch (e) { /* ignore individual failures */ }
-          }
-          device.queuedIntents = [];
-          await device.save();
+        if (standby) {
+          // Hot standby: authenticated and kept warm, but commands keep routing to the
+          // active link until the firmware sends 'promote'. A link demoted after an
+          // RTT-based role swap re-identifies this way and stops receiving commands.
+          ws.standby = true;
+          if (wsDevices.get(mac) === ws) wsDevices.delete(mac);
+          ws.send(JSON.stringify({ type: 'identified', mac, standby: true, mode: device.deviceSecret ? 'secure' : 'insecure' }));
+          logger.info(`[esp32] standby link ready ${mac}`);
+          return;
         }
+        await activateEsp32Link(ws, device);
         // Build minimal switch config (exclude sensitive/internal fields)
         const switchConfig = Array.isArray(device.switches) ? device.switches.map(sw => ({
           gpio: sw.gpio,
@@ -589,29 +648,7 @@ wss.on('connection', (ws) => {
           switches: switchConfig
         }));
         // Immediately send a full config_update so firmware can apply current states and GPIO mapping
-        try {
-          const cfgMsg = {
-            type: 'config_update',
-            mac,
-            switches: device.switches.map((sw, idx) => ({
-              order: idx,
-              gpio: sw.gpio,
-              relayGpio: sw.relayGpio,
-              name: sw.name,
-              manualSwitchGpio: sw.manualSwitchGpio,
-              manualSwitchEnabled: sw.manualSwitchEnabled,
-              manualMode: sw.manualMode,
-              manualActiveLow: sw.manualActiveLow,
-              state: sw.state
-            })),
-            pirEnabled: device.pirEnabled,
-            pirGpio: device.pirGpio,
-            pirAutoOffDelay: device.pirAutoOffDelay
-          };
-          ws.send(JSON.stringify(cfgMsg));
-        } catch (e) {
-          logger.warn('[identify] failed to send config_update', e.message);
-        }
+        sendEsp32ConfigUpdate(ws, device);
         logger.info(`[esp32] identified ${mac}`);
         // Notify frontend clients for immediate UI updates / queued toggle flush
         try { io.emit('device_connected', { deviceId: device.id, mac }); } catch { }
@@ -621,6 +658,24 @@ wss.on('connection', (ws) => {
       return;
     }
     if (!ws.mac) return; // ignore until identified
+    if (type === 'promote') {
+      // Firmware lost its active link and is failing over to this pre-authenticated one
+      if (!ws.standby) return;
+      try {
+        const Device = require('./models/Device');
+        const device = await Device.findOne({ macAddress: ws.mac });
+        if (!device) return;
+        await activateEsp32Link(ws, device);
+        // Ack lets the firmware close its control-gap measurement
+        ws.send(JSON.stringify({ type: 'promoted', mac: ws.mac, ts: Date.now() }));
+        sendEsp32ConfigUpdate(ws, device);
+        logger.info(`[esp32] standby promoted ${ws.mac}`);
+        try { io.emit('device_connected', { deviceId: device.id, mac: ws.mac }); } catch { }
+      } catch (e) {
+        logger.error('[promote] error', e.message);
+      }
+      return;
+    }
     if (type === 'heartbeat') {
       try {
         const Device = require('./models/Device');
@@ -628,6 +683,7 @@ wss.on('connection', (ws) => {
         if (device) {
           device.lastSeen = new Date();
           device.status = 'online';
+          ws.lastSeenAt = device.lastSeen;
           await device.save();
           if (process.env.NODE_ENV !== 'production') {
             console.log('[heartbeat] updated lastSeen', { mac: ws.mac, lastSeen: device.lastSeen.toISOString() });
@@ -691,6 +747,7 @@ wss.on('connection', (ws) => {
           device.pirSensorLastTriggered = new Date();
         }
         device.lastSeen = new Date();
+        ws.lastSeenAt = device.lastSeen;
         await device.save();
         emitDeviceStateChanged(device, { source: 'esp32:state_update' });
         ws.send(JSON.stringify({ type: 'state_ack', ts: Date.now(), changed }));
@@ -699,6 +756,19 @@ wss.on('connection', (ws) => {
       }
       return;
     }
+    if (type === 'diagnostics_report') {
+      // Only the device that was asked may complete the request; the report goes
+      // back to the requesting admin in the HTTP response, not to every dashboard
+      const entry = data.id ? pendingDiagnostics.get(data.id) : undefined;
+      if (!entry || entry.mac !== ws.mac) {
+        logger.warn('[esp32] unexpected diagnostics_report', { mac: ws.mac, id: data.id });
+        return;
+      }
+      pendingDiagnostics.delete(data.id);
+      entry.resolve(data);
+      logger.info(`[esp32] diagnostics_report ${ws.mac}`, { id: data.id, error: data.error });
+      return;
+    }
     if (type === 'switch_result') {
       // HMAC verification first (if enabled)
       try {
@@ -780,19 +850,30 @@ wss.on('connection', (ws) => {
     }
   });
   ws.on('close', () => {
+    // Standby links and links already superseded by a newer one must not take the device offline
+    if (ws.mac && wsDevices.get(ws.mac) !== ws) {
+      logger.info(`[esp32] ${ws.standby ? 'standby' : 'stale'} link closed ${ws.mac}`);
+      return;
+    }
     if (ws.mac) {
       wsDevices.delete(ws.mac);
       logger.info(`[esp32] disconnected ${ws.mac}`);
-      try { io.emit('device_disconnected', { mac: ws.mac }); } catch { }
-      // Immediately mark device offline instead of waiting for periodic scan
+      // Immediately mark device offline instead of waiting for periodic scan.
+      // Conditional on lastSeen: if another backend node has taken the device over
+      // (failover after a pong timeout) it wrote a newer lastSeen and must win.
       (async () => {
         try {
           const Device = require('./models/Device');
-          const d = await Device.findOne({ macAddress: ws.mac });
-          if (d && d.status !== 'offline') {
-            d.status = 'offline';
-            await d.save();
+          const d = await Device.findOneAndUpdate(
+            { macAddress: ws.mac, status: { $ne: 'offline' }, lastSeen: { $lte: ws.lastSeenAt || new Date(0) } },
+            { $set: { status: 'offline' } },
+            { new: true }
+          );
+          if (d) {
+            try { io.emit('device_disconnected', { mac: ws.mac }); } catch { }
             emitDeviceStateChanged(d, { source: 'esp32:ws_close' });
+          } else {
+            logger.info(`[esp32] ${ws.mac} active on another link, not marking offline`);
           }
         } catch (e) {
           logger.error('[ws close offline update] error', e.message);
@@ -0,0 +1,184 @@
+// -----------------------------------------------------------------------------
+// On-device diagnostic benchmarks for field performance comparison
+// Built together with improved_esp32.cpp (same sketch folder). Triggered by the
+// backend with {type:'run_diagnostics', id}; improved_esp32.cpp adds the WS
+// round trip and sends the {type:'diagnostics_report'} message.
+//
+// Relay state is never touched: GPIO timing toggles the status LED only (the
+// blink pattern restores it on the next loop) and is skipped if the backend has
+// mapped a switch onto that pin; NVS timing uses its own "diag" namespace and
+// removes its key afterwards.
+// -----------------------------------------------------------------------------
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <esp_task_wdt.h>
+
+#define DIAG_GPIO_ITERATIONS 1000
+#define DIAG_NVS_ITERATIONS 20 // real flash writes; keep small to limit wear
+#define DIAG_JSON_ITERATIONS 100
+#define DIAG_JSON_SWITCHES 8
+#define DIAG_HMAC_ITERATIONS 50
+#define DIAG_HMAC_MSG_BYTES 1024
+
+// improved_esp32.cpp
+String hmacSha256(const String &key, const String &msg);
+
+// Returns a skip reason if the pin is used by a switch (relay or manual input), else nullptr
+typedef const char *(*PinInUseFn)(int gpio);
+
+static void benchGpio(JsonObject out, int pin, PinInUseFn pinInUse)
+{
+  if (pin == 255)
+  {
+    out["skipped"] = "no_status_led";
+    return;
+  }
+  const char *inUse = pinInUse ? pinInUse(pin) : nullptr;
+  if (inUse)
+  {
+    out["pin"] = pin;
+    out["skipped"] = inUse;
+    return;
+  }
+  pinMode(pin, OUTPUT);
+  unsigned long t0 = micros();
+  for (int i = 0; i < DIAG_GPIO_ITERATIONS; i++)
+    digitalWrite(pin, (i & 1) ? HIGH : LOW);
+  unsigned long us = micros() - t0;
+  digitalWrite(pin, LOW);
+  out["pin"] = pin;
+  out["iterations"] = DIAG_GPIO_ITERATIONS;
+  out["write_avg_ns"] = us * 1000.0f / DIAG_GPIO_ITERATIONS;
+}
+
+static void benchNvs(JsonObject out)
+{
+  Preferences diag;
+  if (!diag.begin("diag", false))
+  {
+    out["error"] = "nvs_open_failed";
+    return;
+  }
+  unsigned long writeUs = 0, readUs = 0, writeMaxUs = 0, readMaxUs = 0;
+  int readErrors = 0;
+  for (int i = 0; i < DIAG_NVS_ITERATIONS; i++)
+  {
+    // Distinct values so NVS cannot skip the write as unchanged
+    unsigned long t0 = micros();
+    diag.putUInt("bench", (uint32_t)i);
+    unsigned long dt = micros() - t0;
+    writeUs += dt;
+    writeMaxUs = max(writeMaxUs, dt);
+
+    t0 = micros();
+    uint32_t v = diag.getUInt("bench", UINT32_MAX);
+    dt = micros() - t0;
+    readUs += dt;
+    readMaxUs = max(readMaxUs, dt);
+    if (v != (uint32_t)i)
+      readErrors++;
+    esp_task_wdt_reset();
+  }
+  diag.remove("bench");
+  diag.end();
+  out["iterations"] = DIAG_NVS_ITERATIONS;
+  out["write_avg_us"] = (float)writeUs / DIAG_NVS_ITERATIONS;
+  out["write_max_us"] = writeMaxUs;
+  out["read_avg_us"] = (float)readUs / DIAG_NVS_ITERATIONS;
+  out["read_max_us"] = readMaxUs;
+  out["read_errors"] = readErrors;
+}
+
+static void benchJson(JsonObject out)
+{
+  // Representative payload: a full state_update for a populated board
+  DynamicJsonDocument doc(1024);
+  doc["type"] = "state_update";
+  doc["seq"] = (long)millis();
+  doc["ts"] = (long)millis();
+  JsonArray arr = doc.createNestedArray("switches");
+  for (int i = 0; i < DIAG_JSON_SWITCHES; i++)
+  {
+    JsonObject o = arr.createNestedObject();
+    o["gpio"] = i;
+    o["state"] = (i & 1) == 1;
+    o["manual_override"] = false;
+  }
+
+  String encoded;
+  unsigned long t0 = micros();
+  for (int i = 0; i < DIAG_JSON_ITERATIONS; i++)
+  {
+    encoded = "";
+    serializeJson(doc, encoded);
+  }
+  unsigned long encodeUs = micros() - t0;
+
+  DynamicJsonDocument parsed(1024);
+  int decodeErrors = 0;
+  t0 = micros();
+  for (int i = 0; i < DIAG_JSON_ITERATIONS; i++)
+  {
+    if (deserializeJson(parsed, encoded) != DeserializationError::Ok)
+      decodeErrors++;
+  }
+  unsigned long decodeUs = micros() - t0;
+
+  out["payload_bytes"] = encoded.length();
+  out["iterations"] = DIAG_JSON_ITERATIONS;
+  out["encode_avg_us"] = (float)encodeUs / DIAG_JSON_ITERATIONS;
+  out["decode_avg_us"] = (float)decodeUs / DIAG_JSON_ITERATIONS;
+  out["decode_errors"] = decodeErrors;
+}
+
+static void benchHmac(JsonObject out)
+{
+  String msg;
+  msg.reserve(DIAG_HMAC_MSG_BYTES);
+  for (int i = 0; i < DIAG_HMAC_MSG_BYTES; i++)
+    msg += (char)('a' + (i % 26));
+  const String key = "diagnostic-benchmark-key";
+
+  if (hmacSha256(key, msg).length() == 0)
+  {
+    out["skipped"] = "hmac_disabled";
+    return;
+  }
+  unsigned long t0 = micros();
+  for (int i = 0; i < DIAG_HMAC_ITERATIONS; i++)
+    hmacSha256(key, msg);
+  unsigned long us = micros() - t0;
+  out["msg_bytes"] = DIAG_HMAC_MSG_BYTES;
+  out["iterations"] = DIAG_HMAC_ITERATIONS;
+  out["avg_us"] = (float)us / DIAG_HMAC_ITERATIONS;
+  out["kb_per_s"] = us ? (DIAG_HMAC_ITERATIONS * (DIAG_HMAC_MSG_BYTES / 1024.0f)) / (us / 1000000.0f) : 0;
+}
+
+static void reportHeap(JsonObject out)
+{
+  size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+  out["free"] = freeHeap;
+  out["largest_block"] = largest;
+  out["min_free"] = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  out["total"] = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+  // 0% = one contiguous free block, approaching 100% = badly fragmented
+  out["fragmentation_pct"] = freeHeap ? 100.0f - (largest * 100.0f / freeHeap) : 0;
+}
+
+// Fill results with gpio / nvs / json / hmac / heap sections
+void runDiagnosticBenchmarks(JsonObject results, int gpioPin, PinInUseFn pinInUse)
+{
+  // Heap first, before the benchmarks allocate anything
+  reportHeap(results.createNestedObject("heap"));
+  benchGpio(results.createNestedObject("gpio"), gpioPin, pinInUse);
+  esp_task_wdt_reset();
+  benchNvs(results.createNestedObject("nvs"));
+  esp_task_wdt_reset();
+  benchJson(results.createNestedObject("json"));
+  esp_task_wdt_reset();
+  benchHmac(results.createNestedObject("hmac"));
+  esp_task_wdt_reset();
+}
@@ -11,6 +11,15 @@
 //  -> state_update  {type:'state_update', switches:[{gpio,state}]}
 //  -> heartbeat     {type:'heartbeat', uptime}
 //  <- state_ack     {type:'state_ack', changed}
+// Failover (see BACKEND_ENDPOINTS):
+//  -> identify      {type:'identify', mac, secret, standby:true}  (standby link)
+//  <- identified    {type:'identified', standby:true}
+//  -> promote       {type:'promote', mac}  (standby takes over, no re-identify)
+//  <- promoted      {type:'promoted'}      (backend routes commands via this link)
+//  -> ping          {type:'ping', t}   <- pong {type:'pong', t}  (RTT probe)
+// Diagnostics (see esp32debugtest.cpp):
+//  <- run_diagnostics    {type:'run_diagnostics', id}
+//  -> diagnostics_report {type:'diagnostics_report', id, results:{heap,gpio,nvs,json,hmac,ws}}
 // -----------------------------------------------------------------------------
 
 #include <WiFi.h>
@@ -34,6 +43,23 @@
 #define HEARTBEAT_MS 30000UL                                             // 30s heartbeat interval
 #define DEVICE_SECRET "9545c46f0f9f494a27412fce1f5b22095550c4e88d82868f" // device secret from backend
 
+// Backend failover: with more than one entry in BACKEND_ENDPOINTS the device keeps a
+// pre-authenticated standby link to the second-nearest endpoint and promotes it when
+// the active link drops, skipping the reconnect interval and identify round trip.
+#ifndef BACKEND_STANDBY_ENABLED
+#define BACKEND_STANDBY_ENABLED 1
+#endif
+#define WS_RECONNECT_MS 5000
+#define BACKEND_PING_MS 5000UL            // application-level RTT probe on open links
+#define BACKEND_PONG_TIMEOUT_MS 12000UL   // no pong for this long => link treated as dead
+#define BACKEND_PROBE_INTERVAL_MS 60000UL // TCP connect probe of one endpoint per interval
+#define BACKEND_PROBE_TIMEOUT_MS 500
+#define BACKEND_RETARGET_MS 15000UL // link down this long => move it to the next best endpoint
+#define BACKEND_SWAP_MARGIN_MS 20   // standby must beat the active RTT by this much to take over
+
+// Diagnostic benchmark: wait this long for the WS round-trip pong before reporting without it
+#define DIAG_RTT_TIMEOUT_MS 5000UL
+
 // Optional status LED (set to 255 to disable if your board lacks LED_BUILTIN)
 #ifndef STATUS_LED_PIN
 #define STATUS_LED_PIN 2
@@ -94,8 +120,60 @@ struct GpioSeq
   long seq;
 };
 
+struct BackendEndpoint
+{
+  const char *host;
+  uint16_t port;
+};
+
+// Measured health per endpoint, fed by WS ping/pong and idle TCP probes
+struct EndpointHealth
+{
+  unsigned long rttMs = 0; // smoothed RTT, 0 = not measured yet
+  bool healthy = true;     // optimistic until a link drops or a probe fails
+};
+
+// One WebSocket connection to a backend endpoint (active or standby role)
+struct BackendLink
+{
+  WebSocketsClient client;
+  int endpoint = -1;             // index into BACKEND_ENDPOINTS, -1 = not started
+  bool connected = false;
+  bool authed = false;           // standby: identified with standby:true
+  bool pongSeen = false;         // backend answers pings (enables pong timeout)
+  unsigned long downSinceMs = 0; // last drop / start time, drives retargeting
+  unsigned long lastPingMs = 0;
+  unsigned long lastPongMs = 0;
+};
+
 // ========= Global Variables =========
-WebSocketsClient ws;
+// Backend endpoints; the lowest-RTT healthy one carries control traffic
+const BackendEndpoint BACKEND_ENDPOINTS[] = {
+    {BACKEND_HOST, BACKEND_PORT},
+    // {"172.16.3.57", BACKEND_PORT}, // second backend node (enables hot standby)
+};
+const int BACKEND_ENDPOINT_COUNT = sizeof(BACKEND_ENDPOINTS) / sizeof(BACKEND_ENDPOINTS[0]);
+EndpointHealth endpointHealth[BACKEND_ENDPOINT_COUNT];
+BackendLink links[2];
+int activeLink = 0;
+bool standbyDisabled = !BACKEND_STANDBY_ENABLED;
+unsigned long lastEndpointProbe = 0;
+unsigned long lastRoleSwapMs = 0;
+// RTT swap in progress: the active link has asked to become the standby and keeps
+// handling commands until the backend acks; only then is the other link promoted
+bool swapPending = false;
+int nextProbeEndpoint = 0;
+// Control gap = last pong on the lost active link -> backend acknowledges the new
+// link (promoted / identified), i.e. commands can be routed to the device again
+unsigned long failoverStartMs = 0;
+unsigned long lastControlGapMs = 0;
+unsigned int failoverCount = 0;
+// Pending run_diagnostics request (report is sent once the RTT pong arrives or times out)
+bool diagPending = false;
+String diagRequestId;
+unsigned long diagPingSentUs = 0;
+unsigned long diagPingSentMs = 0;
+long diagRttUs = -1;
 Preferences prefs;
 QueueHandle_t cmdQueue;
 unsigned long lastHealthCheck = 0;
@@ -176,7 +254,7 @@ void checkSystemHealth()
       Serial.println("[HEALTH] WiFi disconnected!");
     }
 
-    if (!ws.isConnected() && !isOfflineMode)
+    if (!activeWs().isConnected() && !isOfflineMode)
     {
       Serial.println("[HEALTH] WebSocket disconnected!");
     }
@@ -220,9 +298,12 @@ bool identified = false;
 int reconnectionAttempts = 0;
 
 // Forward declarations
+WebSocketsClient &activeWs();
 void sendJson(const JsonDocument &doc);
+void sendJsonOn(int link, const JsonDocument &doc);
 String hmacSha256(const String &key, const String &msg);
 void identify();
+void identifyOn(int link, bool standby);
 void sendStateUpdate(bool force);
 void sendHeartbeat();
 long getLastSeq(int gpio);
@@ -231,7 +312,21 @@ bool applySwitchState(int gpio, bool state);
 void loadConfigFromJsonArray(JsonArray arr);
 void saveConfigToNVS();
 void loadConfigFromNVS();
-void onWsEvent(WStype_t type, uint8_t *payload, size_t length);
+void onWsEvent(int link, WStype_t type, uint8_t *payload, size_t length);
+void startLink(int link, int endpoint);
+int pickEndpoint(int exclude);
+void recordRtt(int endpoint, unsigned long rttMs);
+void promoteStandby(int link);
+void markControlRestored(const char *how);
+void serviceBackendLinks();
+void maintainBackendLinks();
+void probeNextEndpoint();
+bool probeEndpoint(int endpoint);
+void probeAllEndpoints();
+void startDiagnostics(const char *id);
+void handleDiagnostics();
+const char *switchPinInUse(int gpio);
+void runDiagnosticBenchmarks(JsonObject results, int gpioPin, const char *(*pinInUse)(int)); // esp32debugtest.cpp
 void setupRelays();
 void processCommandQueue();
 void blinkStatus();
@@ -240,14 +335,24 @@ void handleManualSwitches();
 // -----------------------------------------------------------------------------
 // Utility helpers
 // -----------------------------------------------------------------------------
+WebSocketsClient &activeWs()
+{
+  return links[activeLink].client;
+}
+
 void sendJson(const JsonDocument &doc)
 {
-  if (!ws.isConnected())
+  sendJsonOn(activeLink, doc);
+}
+
+void sendJsonOn(int link, const JsonDocument &doc)
+{
+  if (!links[link].client.isConnected())
     return;
 
   String out;
   serializeJson(doc, out);
-  ws.sendTXT(out);
+  links[link].client.sendTXT(out);
 }
 
 String hmacSha256(const String &key, const String &msg)
@@ -276,14 +381,21 @@ String hmacSha256(const String &key, const String &msg)
 }
 
 void identify()
+{
+  identifyOn(activeLink, false);
+  lastIdentifyAttempt = millis();
+}
+
+void identifyOn(int link, bool standby)
 {
   DynamicJsonDocument doc(256);
   doc["type"] = "identify";
   doc["mac"] = WiFi.macAddress();
   doc["secret"] = DEVICE_SECRET; // simple shared secret (upgrade to HMAC if needed)
   doc["offline_capable"] = true; // Indicate this device supports offline mode
-  sendJson(doc);
-  lastIdentifyAttempt = millis();
+  if (standby)
+    doc["standby"] = true; // authenticate only; backend keeps routing to the active link
+  sendJsonOn(link, doc);
 }
 
 void sendStateUpdate(bool force)
@@ -298,7 +410,7 @@ void sendStateUpdate(bool force)
   lastStateSent = now;
 
   // Don't try to send if not connected
-  if (!ws.isConnected())
+  if (!activeWs().isConnected())
     return;
 
   DynamicJsonDocument doc(512);
@@ -333,13 +445,16 @@ void sendHeartbeat()
     return;
   lastHeartbeat = now;
 
-  if (ws.isConnected())
+  if (activeWs().isConnected())
   {
     DynamicJsonDocument doc(256);
     doc["type"] = "heartbeat";
     doc["mac"] = WiFi.macAddress();
     doc["uptime"] = millis() / 1000;
     doc["offline_mode"] = isOfflineMode;
+    doc["backend_rtt_ms"] = endpointHealth[links[activeLink].endpoint].rttMs;
+    doc["failovers"] = failoverCount;
+    doc["control_gap_ms"] = lastControlGapMs;
     sendJson(doc);
     Serial.println("[WS] -> heartbeat");
   }
@@ -607,11 +722,346 @@ void loadConfigFromNVS()
   Serial.printf("[NVS] Loaded %d switches\n", (int)switchesLocal.size());
 }
 
-void onWsEvent(WStype_t type, uint8_t *payload, size_t len)
+// -----------------------------------------------------------------------------
+// Backend links / failover
+// -----------------------------------------------------------------------------
+void startLink(int link, int endpoint)
+{
+  BackendLink &l = links[link];
+  if (l.endpoint >= 0)
+    l.client.disconnect();
+  l.endpoint = endpoint;
+  l.connected = false;
+  l.authed = false;
+  l.pongSeen = false;
+  l.downSinceMs = millis();
+  const BackendEndpoint &ep = BACKEND_ENDPOINTS[endpoint];
+  l.client.begin(ep.host, ep.port, WS_PATH);
+  l.client.onEvent([link](WStype_t type, uint8_t *payload, size_t len)
+                   { onWsEvent(link, type, payload, len); });
+  l.client.setReconnectInterval(WS_RECONNECT_MS);
+  Serial.printf("[BACKEND] link %d -> %s:%u (%s)\n", link, ep.host, ep.port,
+                link == activeLink ? "active" : "standby");
+}
+
+// Lowest smoothed RTT among healthy endpoints; unmeasured ones rank as a probe
+// timeout so list order decides until RTTs are known
+int pickEndpoint(int exclude)
+{
+  int best = -1;
+  unsigned long bestRtt = 0;
+  for (int i = 0; i < BACKEND_ENDPOINT_COUNT; i++)
+  {
+    if (i == exclude || !endpointHealth[i].healthy)
+      continue;
+    unsigned long rtt = endpointHealth[i].rttMs ? endpointHealth[i].rttMs : BACKEND_PROBE_TIMEOUT_MS;
+    if (best < 0 || rtt < bestRtt)
+    {
+      best = i;
+      bestRtt = rtt;
+    }
+  }
+  if (best < 0)
+  {
+    // Nothing known-healthy: keep trying endpoints in list order
+    for (int i = 0; i < BACKEND_ENDPOINT_COUNT; i++)
+    {
+      if (i != exclude)
+        return i;
+    }
+  }
+  return best;
+}
+
+void recordRtt(int endpoint, unsigned long rttMs)
+{
+  EndpointHealth &h = endpointHealth[endpoint];
+  h.healthy = true;
+  if (rttMs == 0)
+    rttMs = 1; // keep 0 reserved for "not measured"
+  h.rttMs = h.rttMs ? (h.rttMs * 3 + rttMs) / 4 : rttMs;
+}
+
+void markControlRestored(const char *how)
+{
+  if (failoverStartMs == 0)
+    return;
+  lastControlGapMs = millis() - failoverStartMs;
+  failoverStartMs = 0;
+  failoverCount++;
+  Serial.printf("[FAILOVER] control gap %lu ms (%s, failovers=%u)\n", lastControlGapMs, how, failoverCount);
+}
+
+// Standby link is already authenticated: switch roles and tell the backend to
+// route this device through it. No identify round trip is needed before
+// accepting commands or reporting state.
+void promoteStandby(int link)
+{
+  activeLink = link;
+  identified = true;
+  isOfflineMode = false;
+  connState = BACKEND_CONNECTED;
+  lastSeqs.clear();
+  DynamicJsonDocument doc(128);
+  doc["type"] = "promote";
+  doc["mac"] = WiFi.macAddress();
+  sendJson(doc);
+  sendStateUpdate(true);
+  Serial.printf("[BACKEND] standby link %d promoted to active (%s)\n", link, BACKEND_ENDPOINTS[links[link].endpoint].host);
+  // Control gap closes when the backend answers with 'promoted'
+}
+
+// Pump both links and run the ping/pong RTT probe. A link whose backend stops
+// answering pings is torn down so the disconnect path (failover) runs.
+void serviceBackendLinks()
+{
+  for (int i = 0; i < 2; i++)
+  {
+    BackendLink &l = links[i];
+    if (l.endpoint < 0)
+      continue;
+    // Standby aimed at a node that failed its last probe is parked: arduinoWebSockets
+    // connects synchronously (up to WEBSOCKETS_TCP_TIMEOUT), which would stall loop()
+    // on every reconnect attempt. probeNextEndpoint() revives it.
+    if (i != activeLink && !l.connected && !endpointHealth[l.endpoint].healthy)
+      continue;
+    l.client.loop();
+    if (!l.connected)
+      continue;
+    unsigned long now = millis();
+    if (l.pongSeen && now - l.lastPongMs > BACKEND_PONG_TIMEOUT_MS)
+    {
+      Serial.printf("[BACKEND] link %d pong timeout, dropping\n", i);
+      l.client.disconnect();
+      continue;
+    }
+    if (now - l.lastPingMs >= BACKEND_PING_MS)
+    {
+      l.lastPingMs = now;
+      DynamicJsonDocument doc(64);
+      doc["type"] = "ping";
+      doc["t"] = now;
+      sendJsonOn(i, doc);
+    }
+  }
+}
+
+// Start / retarget links toward the nearest healthy endpoints (WiFi up only).
+// An authed standby takes over when the active link is down, or when its RTT is
+// lower by BACKEND_SWAP_MARGIN_MS (at most once per probe interval).
+void maintainBackendLinks()
+{
+  unsigned long now = millis();
+  BackendLink &a = links[activeLink];
+  int standby = 1 - activeLink;
+  BackendLink &s = links[standby];
+
+  if (!a.connected && s.connected && s.authed)
+  {
+    promoteStandby(standby);
+    return;
+  }
+
+  if (a.connected && identified && s.connected && s.authed && failoverStartMs == 0 &&
+      !swapPending && now - lastRoleSwapMs >= BACKEND_PROBE_INTERVAL_MS)
+  {
+    unsigned long aRtt = endpointHealth[a.endpoint].rttMs;
+    unsigned long sRtt = endpointHealth[s.endpoint].rttMs;
+    if (aRtt && sRtt && sRtt + BACKEND_SWAP_MARGIN_MS < aRtt)
+    {
+      lastRoleSwapMs = now;
+      Serial.printf("[BACKEND] standby rtt %lu ms < active %lu ms, swapping roles\n", sRtt, aRtt);
+      // Demote first; the standby is promoted once the backend acks (see "identified")
+      swapPending = true;
+      identifyOn(activeLink, true);
+      return;
+    }
+  }
+
+  if (a.endpoint < 0)
+  {
+    // WiFi was down at boot, so setup() never started the active link
+    probeAllEndpoints();
+    int ep = pickEndpoint(s.endpoint);
+    if (ep >= 0)
+      startLink(activeLink, ep);
+  }
+  else if (!a.connected && BACKEND_ENDPOINT_COUNT > 1 && now - a.downSinceMs >= BACKEND_RETARGET_MS)
+  {
+    int ep = pickEndpoint(s.endpoint);
+    if (ep >= 0 && ep != a.endpoint)
+      startLink(activeLink, ep);
+    else
+      a.downSinceMs = now;
+  }
+
+  // Standby starts once the active link is up (or has been failing for a while), so
+  // a faster standby handshake cannot grab the active role from the nearest node
+  if (!standbyDisabled && BACKEND_ENDPOINT_COUNT > 1 &&
+      (a.connected || s.endpoint >= 0 || now - a.downSinceMs >= BACKEND_RETARGET_MS))
+  {
+    if (s.endpoint < 0 || (!s.connected && now - s.downSinceMs >= BACKEND_RETARGET_MS))
+    {
+      int ep = pickEndpoint(a.endpoint);
+      if (ep >= 0 && ep != s.endpoint)
+        startLink(standby, ep);
+      else
+      {
+        s.downSinceMs = now;
+        // No other node to try: park the standby until a probe reaches it again
+        if (s.endpoint >= 0)
+          endpointHealth[s.endpoint].healthy = false;
+      }
+    }
+  }
+
+  probeNextEndpoint();
+}
+
+// Measure TCP connect time to one endpoint (blocks up to BACKEND_PROBE_TIMEOUT_MS)
+bool probeEndpoint(int i)
 {
+  WiFiClient probe;
+  unsigned long t0 = millis();
+  bool ok = probe.connect(BACKEND_ENDPOINTS[i].host, BACKEND_ENDPOINTS[i].port, BACKEND_PROBE_TIMEOUT_MS);
+  unsigned long rtt = millis() - t0;
+  probe.stop();
+  esp_task_wdt_reset();
+  if (ok)
+    recordRtt(i, rtt);
+  else
+    endpointHealth[i].healthy = false;
+  Serial.printf("[BACKEND] probe %s:%u %s rtt=%lu ms\n", BACKEND_ENDPOINTS[i].host, BACKEND_ENDPOINTS[i].port,
+                ok ? "ok" : "failed", rtt);
+  return ok;
+}
+
+// One pass over every endpoint before the first link is started, so the
+// initial choice is the nearest node rather than list entry 0
+void probeAllEndpoints()
+{
+  if (BACKEND_ENDPOINT_COUNT < 2)
+    return;
+  for (int i = 0; i < BACKEND_ENDPOINT_COUNT; i++)
+    probeEndpoint(i);
+  lastEndpointProbe = millis();
+}
+
+// Round-robin probe of one endpoint per interval; keeps RTTs fresh for nodes
+// without an open link and cross-checks the ping/pong numbers of linked ones
+void probeNextEndpoint()
+{
+  unsigned long now = millis();
+  if (BACKEND_ENDPOINT_COUNT < 2 || now - lastEndpointProbe < BACKEND_PROBE_INTERVAL_MS)
+    return;
+  lastEndpointProbe = now;
+  const BackendLink &s = links[1 - activeLink];
+  if (s.endpoint >= 0 && !s.connected && !endpointHealth[s.endpoint].healthy)
+  {
+    // Parked standby: only a successful probe lets serviceBackendLinks() reconnect it
+    probeEndpoint(s.endpoint);
+    return;
+  }
+  int i = nextProbeEndpoint % BACKEND_ENDPOINT_COUNT;
+  nextProbeEndpoint = i + 1;
+  probeEndpoint(i);
+}
+
+// -----------------------------------------------------------------------------
+// Remote diagnostics
+// -----------------------------------------------------------------------------
+void startDiagnostics(const char *id)
+{
+  if (diagPending)
+  {
+    DynamicJsonDocument res(128);
+    res["type"] = "diagnostics_report";
+    res["id"] = id;
+    res["error"] = "busy";
+    sendJson(res);
+    return;
+  }
+  diagPending = true;
+  diagRequestId = id;
+  diagRttUs = -1;
+  // Dedicated ping measured in microseconds; the pong is matched by id
+  DynamicJsonDocument doc(128);
+  doc["type"] = "ping";
+  doc["t"] = millis();
+  doc["id"] = diagRequestId;
+  diagPingSentMs = millis();
+  diagPingSentUs = micros();
+  sendJson(doc);
+  Serial.printf("[DIAG] run_diagnostics id=%s\n", id);
+}
+
+// Keeps the GPIO benchmark off any pin the current switch config uses
+const char *switchPinInUse(int gpio)
+{
+  for (auto &sw : switchesLocal)
+  {
+    if (sw.gpio == gpio)
+      return "pin_in_use_by_relay";
+    if (sw.manualEnabled && sw.manualGpio == gpio)
+      return "pin_in_use_by_manual_switch";
+  }
+  return nullptr;
+}
+
+// Runs from loop() (not inside the WS callback) once the RTT sample is in
+void handleDiagnostics()
+{
+  if (!diagPending)
+    return;
+  if (diagRttUs < 0 && millis() - diagPingSentMs < DIAG_RTT_TIMEOUT_MS)
+    return;
+  diagPending = false;
+
+  unsigned long t0 = millis();
+  DynamicJsonDocument doc(1536);
+  doc["type"] = "diagnostics_report";
+  doc["mac"] = WiFi.macAddress();
+  doc["id"] = diagRequestId;
+  doc["uptime"] = millis() / 1000;
+  doc["chip"] = ESP.getChipModel();
+  doc["cpu_mhz"] = ESP.getCpuFreqMHz();
+  doc["sdk"] = ESP.getSdkVersion();
+  doc["switches"] = switchesLocal.size();
+  JsonObject results = doc.createNestedObject("results");
+  runDiagnosticBenchmarks(results, STATUS_LED_PIN, switchPinInUse);
+  JsonObject wsr = results.createNestedObject("ws");
+  wsr["endpoint"] = BACKEND_ENDPOINTS[links[activeLink].endpoint].host;
+  if (diagRttUs >= 0)
+    wsr["rtt_ms"] = diagRttUs / 1000.0f;
+  else
+    wsr["rtt_ms"] = nullptr; // pong did not arrive within DIAG_RTT_TIMEOUT_MS
+  wsr["smoothed_rtt_ms"] = endpointHealth[links[activeLink].endpoint].rttMs;
+  doc["elapsed_ms"] = millis() - t0;
+  sendJson(doc);
+  Serial.printf("[DIAG] -> diagnostics_report id=%s (%lu ms)\n", diagRequestId.c_str(), millis() - t0);
+}
+
+void onWsEvent(int link, WStype_t type, uint8_t *payload, size_t len)
+{
+  BackendLink &l = links[link];
   switch (type)
   {
   case WStype_CONNECTED:
+    l.connected = true;
+    l.authed = false;
+    l.pongSeen = false;
+    l.lastPingMs = 0;
+    l.lastPongMs = millis();
+    endpointHealth[l.endpoint].healthy = true;
+    // Standby came up while the active link is down: let it carry control instead
+    if (link != activeLink && !links[activeLink].connected)
+      activeLink = link;
+    if (link != activeLink)
+    {
+      Serial.printf("[BACKEND] standby link %d connected, pre-authenticating\n", link);
+      identifyOn(link, true);
+      break;
+    }
     Serial.println("WS connected");
     identified = false;
     isOfflineMode = false;
@@ -636,9 +1086,72 @@ void onWsEvent(WStype_t type, uint8_t *payload, size_t len)
         return;
       }
       const char *msgType = doc["type"] | "";
+      if (strcmp(msgType, "pong") == 0)
+      {
+        unsigned long sent = doc["t"] | 0UL;
+        l.lastPongMs = millis();
+        l.pongSeen = true;
+        if (diagPending && diagRttUs < 0 && link == activeLink && diagRequestId == (doc["id"] | ""))
+          diagRttUs = micros() - diagPingSentUs;
+        if (sent)
+          recordRtt(l.endpoint, l.lastPongMs - sent);
+        return;
+      }
+      if (link != activeLink)
+      {
+        // Standby link only authenticates; commands/config arrive on the active link
+        if (strcmp(msgType, "identified") == 0)
+        {
+          if (doc["standby"] | false)
+          {
+            l.authed = true;
+            Serial.printf("[BACKEND] standby link %d ready (%s)\n", link, BACKEND_ENDPOINTS[l.endpoint].host);
+            // Active link dropped while this one was still authenticating
+            if (!links[activeLink].connected)
+              promoteStandby(link);
+          }
+          else
+          {
+            // Backend without standby support registered this link as primary; back off.
+            // Clear the endpoint first so the disconnect does not mark a working node unhealthy.
+            Serial.println(F("[BACKEND] backend ignored standby flag, disabling standby"));
+            standbyDisabled = true;
+            l.endpoint = -1;
+            l.client.disconnect();
+          }
+        }
+        else
+        {
+          Serial.printf("[BACKEND] standby <- %s\n", msgType);
+        }
+        return;
+      }
+      if (strcmp(msgType, "promoted") == 0)
+      {
+        markControlRestored("standby promoted");
+        return;
+      }
+      if (strcmp(msgType, "identified") == 0 && swapPending && (doc["standby"] | false))
+      {
+        // RTT swap: backend now treats this link as the standby, hand control over
+        swapPending = false;
+        if (links[1 - link].connected && links[1 - link].authed)
+        {
+          l.authed = true;
+          promoteStandby(1 - link);
+        }
+        else
+        {
+          Serial.println(F("[BACKEND] standby lost during swap, re-identifying"));
+          identify();
+        }
+        return;
+      }
       if (strcmp(msgType, "identified") == 0)
       {
+        swapPending = false;
         identified = true;
+        markControlRestored("re-identified");
         isOfflineMode = false;
         if (STATUS_LED_PIN != 255)
           digitalWrite(STATUS_LED_PIN, HIGH);
@@ -721,6 +1234,11 @@ void onWsEvent(WStype_t type, uint8_t *payload, size_t len)
         }
         return;
       }
+      if (strcmp(msgType, "run_diagnostics") == 0)
+      {
+        startDiagnostics(doc["id"] | "");
+        return;
+      }
       Serial.printf("[WS] <- unhandled type=%s Raw=%.*s\n", msgType, (int)len, payload);
     }
     catch (const std::exception &e)
@@ -731,6 +1249,32 @@ void onWsEvent(WStype_t type, uint8_t *payload, size_t len)
     break;
   }
   case WStype_DISCONNECTED:
+  {
+    bool wasUp = l.connected;
+    // On a WiFi drop the active link usually reports first while the standby still
+    // looks up; that is not a backend failure, so take the normal offline path
+    bool wifiUp = WiFi.status() == WL_CONNECTED;
+    l.connected = false;
+    l.authed = false;
+    l.downSinceMs = millis();
+    if (wasUp && wifiUp && l.endpoint >= 0)
+      endpointHealth[l.endpoint].healthy = false;
+    if (link != activeLink)
+    {
+      if (wasUp)
+        Serial.printf("[BACKEND] standby link %d lost\n", link);
+      break;
+    }
+    swapPending = false;
+    // Count from the last sign of life, not from when the loss was noticed
+    if (wasUp && wifiUp && failoverStartMs == 0)
+      failoverStartMs = l.pongSeen ? l.lastPongMs : millis();
+    if (wifiUp && links[1 - link].connected && links[1 - link].authed)
+    {
+      Serial.println("WS disconnected, failing over to standby");
+      promoteStandby(1 - link);
+      break;
+    }
     Serial.println("WS disconnected");
     identified = false;
     isOfflineMode = true;
@@ -739,6 +1283,7 @@ void onWsEvent(WStype_t type, uint8_t *payload, size_t len)
       digitalWrite(STATUS_LED_PIN, LOW);
     reportError("WEBSOCKET", "Connection lost");
     break;
+  }
   default:
     break;
   }
@@ -930,10 +1475,9 @@ void setup()
     // Configure time
     configTime(0, 0, "pool.ntp.org");
 
-    // Setup WebSocket connection
-    ws.begin(BACKEND_HOST, BACKEND_PORT, WS_PATH);
-    ws.onEvent(onWsEvent);
-    ws.setReconnectInterval(5000);
+    // Setup WebSocket connection to the nearest node (standby link follows from maintainBackendLinks)
+    probeAllEndpoints();
+    startLink(activeLink, pickEndpoint(-1));
     isOfflineMode = false;
   }
   else
@@ -986,7 +1530,8 @@ void loop()
   }
   else
   {
-    if (!ws.isConnected())
+    maintainBackendLinks();
+    if (!activeWs().isConnected())
     {
       connState = WIFI_ONLY;
       isOfflineMode = true;
@@ -1004,7 +1549,7 @@ void loop()
   }
 
   // Process WebSocket events
-  ws.loop();
+  serviceBackendLinks();
   esp_task_wdt_reset(); // Reset watchdog after WebSocket operations
 
   // Process command queue
@@ -1015,6 +1560,9 @@ void loop()
 
   // ...existing code...
 
+  // Finish a pending run_diagnostics request
+  handleDiagnostics();
+
   // Send heartbeat
   sendHeartbeat();
 